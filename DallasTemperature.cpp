@@ -7,8 +7,17 @@
 // See Includes...
 // Modified by Jordan Hochenbaum
 
+#include <string.h>
 #include "DallasTemperature.h"
 
+// orders the buffer accesses around readingSequence; a compiler barrier is
+// enough on single core AVR, other targets may reorder in hardware
+#if defined(__AVR__)
+#define READING_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+#else
+#define READING_BARRIER() __sync_synchronize()
+#endif
+
 #if ARDUINO >= 100
     #include "Arduino.h"   
 #else
@@ -21,7 +30,28 @@ DallasTemperature::DallasTemperature(DS2480B* _oneWire)
 {
   _wire = _oneWire;
   devices = 0;
+  handles = 0;
+#if REQUIRESTRACE
+  traceBuffer = NULL;
+  traceSize = 0;
+  traceLength = 0;
+  traceDropped = 0;
+#endif
+  tickState = TICK_IDLE;
+  tickSensor = 0;
+  tickExternalStart = 0;
+  tickExternalDelay = 0;
+  // unmeasured steps only ever run first in a call
+  for (uint8_t i = 0; i < TICK_STEP_KINDS; i++) tickCost[i] = TICK_UNMEASURED;
+  memset(pendingResolution, 0, sizeof(pendingResolution));
+#if REQUIRESSNAPSHOT
+  readingDevices[0] = 0;
+  readingSequence = 0;
+  conversionStarted = false;
+#endif
   parasite = false;
+  parasiteBudget = 0xFFFF;
+  convertCursor = 0;
   bitResolution = 9;
   waitForConversion = true;
   checkForConversion = true;
@@ -33,27 +63,61 @@ void DallasTemperature::begin(void)
   DeviceAddress deviceAddress;
   uint8_t count;
 
-  _wire->begin();
-  _wire->reset_search();
+  busBegin();
   devices = 0; // Reset the number of devices when we enumerate wire devices
+  parasite = false;
+  tickState = TICK_IDLE; // indices are about to change under any cycle in progress
+  tickSensor = 0;
+  memset(pendingResolution, 0, sizeof(pendingResolution));
+#if REQUIRESSNAPSHOT
+  conversionStarted = false;
+#endif
 
-  while (_wire->search(deviceAddress))
+  while (devices < MAX_DEVICES && busSearch(deviceAddress))
   {
     if (validAddress(deviceAddress))
     {
-	  resetStats(devices);
-	  for (count = 0; count < 8; count++) sensors[devices].address[count] = deviceAddress[count];
-	  sensors[devices].offset = 0;
+      // count the device first, the per index calls below fall back to
+      // index 0 for anything past the end
+      uint8_t index = devices++;
+
+	  resetStats(index);
+	  for (count = 0; count < 8; count++) sensors[index].address[count] = deviceAddress[count];
+	  sensors[index].offset = 0;
 
-      if (!parasite && readPowerSupply(devices)) parasite = true;
+      sensors[index].parasitePowered = readPowerSupply(index);
+      if (sensors[index].parasitePowered) parasite = true;
 
+      // only the current temperature, the 85C power on value would
+      // otherwise land in the min, max and average
       ScratchPad scratchPad;
+      readScratchPad(index, scratchPad, 3);
+      busReset();
+
+      uint8_t resolution = scratchPadResolution(index, scratchPad);
+      sensors[index].resolution = resolution;
+      if (resolution > bitResolution) bitResolution = resolution;
+    }
+  }
 
-      readScratchPad(devices, scratchPad);
+  buildRomIndex();
+#if REQUIRESSNAPSHOT
+  publishReadings();
+#endif
+}
 
-	  bitResolution = max(bitResolution, getResolution(devices));
-      devices++;
+// insertion sort of the device indices by address, N is at most MAX_DEVICES
+void DallasTemperature::buildRomIndex(void)
+{
+  for (uint8_t i = 0; i < devices; i++)
+  {
+    uint8_t j = i;
+    while (j > 0 && memcmp(sensors[romIndex[j - 1]].address, sensors[i].address, 8) > 0)
+    {
+      romIndex[j] = romIndex[j - 1];
+      j--;
     }
+    romIndex[j] = i;
   }
 }
 
@@ -106,6 +170,69 @@ bool DallasTemperature::validAddress(uint8_t* deviceAddress)
   return (_wire->crc8(deviceAddress, 7) == deviceAddress[7]);
 }
 
+// copies the address of the device at the given index
+bool DallasTemperature::getAddress(uint8_t* deviceAddress, uint8_t index)
+{
+  if (index >= devices) return false;
+  memcpy(deviceAddress, sensors[index].address, 8);
+  return true;
+}
+
+// binary search of romIndex, returns -1 if the address was not found by begin()
+int8_t DallasTemperature::getIndex(const uint8_t* deviceAddress)
+{
+  uint8_t low = 0;
+  uint8_t high = devices;
+
+  while (low < high)
+  {
+    uint8_t mid = (low + high) >> 1;
+    int cmp = memcmp(sensors[romIndex[mid]].address, deviceAddress, 8);
+    if (cmp == 0) return romIndex[mid];
+    if (cmp < 0) low = mid + 1;
+    else high = mid;
+  }
+  return -1;
+}
+
+// a handle is a slot in handleAddress, so it keeps naming the same ROM no
+// matter how often begin() reorders the sensors. Once every slot is taken,
+// a slot whose ROM was not found by the last begin() is handed out again
+// with the generation in its upper bits bumped, so old handles go stale.
+SensorHandle DallasTemperature::getHandle(const uint8_t* deviceAddress)
+{
+  for (uint8_t i = 0; i < handles; i++)
+  {
+    if (memcmp(handleAddress[i], deviceAddress, 8) == 0) return handleIssued[i];
+  }
+
+  uint8_t slot = handles;
+  if (handles < MAX_DEVICES)
+  {
+    handles++;
+    handleIssued[slot] = slot;
+  }
+  else
+  {
+    // reclaim the slot of a device that has left the bus, e.g. a replaced probe
+    for (slot = 0; slot < handles; slot++)
+    {
+      if (getIndex(handleAddress[slot]) < 0) break;
+    }
+    if (slot >= handles) return INVALID_HANDLE;
+    handleIssued[slot] += 1 << HANDLE_SLOT_BITS;
+  }
+  memcpy(handleAddress[slot], deviceAddress, 8);
+  return handleIssued[slot];
+}
+
+int8_t DallasTemperature::getIndexByHandle(SensorHandle handle)
+{
+  uint8_t slot = handle & HANDLE_SLOT_MASK;
+  if (slot >= handles || handleIssued[slot] != handle) return -1;
+  return getIndex(handleAddress[slot]);
+}
+
 bool DallasTemperature::readSensor(uint8_t index, uint8_t debug)
 {
   ScratchPad scratchPad;
@@ -131,14 +258,11 @@ bool DallasTemperature::isConnected(uint8_t index, uint8_t* scratchPad, uint8_t
 void DallasTemperature::readScratchPad(uint8_t index, uint8_t* scratchPad, uint8_t debug)
 {
 	if (index >= devices) index = 0;
-	int32_t temp;
-	int16_t returnedTemp;
-	int8_t scaledTemp;
 
   // send the command
-  _wire->reset();
-  _wire->select(sensors[index].address);
-  _wire->write(READSCRATCH);
+  busReset();
+  busSelect(sensors[index].address);
+  busWrite(READSCRATCH);
 
   // TODO => collect all comments &  use simple loop
   // byte 0: temperature LSB  
@@ -163,39 +287,51 @@ void DallasTemperature::readScratchPad(uint8_t index, uint8_t* scratchPad, uint8
   // read the response
 
   // byte 0: temperature LSB
-  scratchPad[TEMP_LSB] = _wire->read();
+  scratchPad[TEMP_LSB] = busRead();
 
   // byte 1: temperature MSB
-  scratchPad[TEMP_MSB] = _wire->read();
+  scratchPad[TEMP_MSB] = busRead();
 
   // byte 2: high alarm temp
-  scratchPad[HIGH_ALARM_TEMP] = _wire->read();
+  scratchPad[HIGH_ALARM_TEMP] = busRead();
 
   // byte 3: low alarm temp
-  scratchPad[LOW_ALARM_TEMP] = _wire->read();
+  scratchPad[LOW_ALARM_TEMP] = busRead();
 
   // byte 4:
   // DS18S20: store for crc
   // DS18B20 & DS1822: configuration register
-  scratchPad[CONFIGURATION] = _wire->read();
+  scratchPad[CONFIGURATION] = busRead();
 
   // byte 5:
   // internal use & crc
-  scratchPad[INTERNAL_BYTE] = _wire->read();
+  scratchPad[INTERNAL_BYTE] = busRead();
 
   // byte 6:
   // DS18S20: COUNT_REMAIN
   // DS18B20 & DS1822: store for crc
-  scratchPad[COUNT_REMAIN] = _wire->read();
+  scratchPad[COUNT_REMAIN] = busRead();
 
   // byte 7:
   // DS18S20: COUNT_PER_C
   // DS18B20 & DS1822: store for crc
-  scratchPad[COUNT_PER_C] = _wire->read();
+  scratchPad[COUNT_PER_C] = busRead();
 
   // byte 8:
   // SCTRACHPAD_CRC
-  scratchPad[SCRATCHPAD_CRC] = _wire->read();
+  scratchPad[SCRATCHPAD_CRC] = busRead();
+
+  processScratchPad(index, scratchPad, debug);
+  if (debug >= 5) busReset();
+}
+
+// updates the device's current reading, min/max, faults and average
+// debug stops the update after the given stage, 0xFF runs all of it
+void DallasTemperature::processScratchPad(uint8_t index, const uint8_t* scratchPad, uint8_t debug)
+{
+	int32_t temp;
+	int16_t returnedTemp;
+	int8_t scaledTemp;
 
   if (debug < 2) return;
 
@@ -210,6 +346,9 @@ void DallasTemperature::readScratchPad(uint8_t index, uint8_t* scratchPad, uint8
   if (temp < -3000 && sensors[index].offset == 0) sensors[index].offset = 5500;
   temp += sensors[index].offset;
   sensors[index].currentTemp = ((int16_t)temp);
+#if REQUIRESSNAPSHOT
+  sensors[index].measured = conversionStarted;
+#endif
 
   if (debug < 4) return;
 
@@ -235,8 +374,6 @@ void DallasTemperature::readScratchPad(uint8_t index, uint8_t* scratchPad, uint8
 	  sensors[index].avgTempReadings /= 2;
 	  sensors[index].avgTempAccumulator /= 2;
   }
-
-  _wire->reset();
 }
 
 int16_t DallasTemperature::getCelsius(uint8_t index)
@@ -257,18 +394,26 @@ int16_t DallasTemperature::getFahrenheit(uint8_t index)
 void DallasTemperature::writeScratchPad(uint8_t index, const uint8_t* scratchPad)
 {
   if (index >= devices) index = 0;
-  _wire->reset();
-  _wire->select(sensors[index].address);
-  _wire->write(WRITESCRATCH);
-  _wire->write(scratchPad[HIGH_ALARM_TEMP]); // high alarm temp
-  _wire->write(scratchPad[LOW_ALARM_TEMP]); // low alarm temp
-  // DS18S20 does not use the configuration register
-  if (sensors[index].address[0] != DS18S20MODEL) _wire->write(scratchPad[CONFIGURATION]); // configuration
-  _wire->reset();
+  sendScratchPad(index, scratchPad);
   // save the newly written values to eeprom
-  _wire->write(COPYSCRATCH, parasite);
-  if (parasite) delay(10); // 10ms delay
-  _wire->reset();
+  busSelect(sensors[index].address);
+  busWrite(COPYSCRATCH, sensors[index].parasitePowered);
+  if (sensors[index].parasitePowered) delay(10); // 10ms delay
+  busReset();
+}
+
+// writes the alarm and configuration bytes, leaving the bus reset
+// and ready for the COPYSCRATCH that makes them permanent
+void DallasTemperature::sendScratchPad(uint8_t index, const uint8_t* scratchPad)
+{
+  busReset();
+  busSelect(sensors[index].address);
+  busWrite(WRITESCRATCH);
+  busWrite(scratchPad[HIGH_ALARM_TEMP]); // high alarm temp
+  busWrite(scratchPad[LOW_ALARM_TEMP]); // low alarm temp
+  // DS18S20 does not use the configuration register
+  if (sensors[index].address[0] != DS18S20MODEL) busWrite(scratchPad[CONFIGURATION]); // configuration
+  busReset();
 }
 
 // reads the device's power requirements
@@ -276,11 +421,11 @@ bool DallasTemperature::readPowerSupply(uint8_t index)
 {
   if (index >= devices) index = 0;
   bool ret = false;
-  _wire->reset();
-  _wire->select(sensors[index].address);
-  _wire->write(READPOWERSUPPLY);
-  if (_wire->read_bit() == 0) ret = true;
-  _wire->reset();
+  busReset();
+  busSelect(sensors[index].address);
+  busWrite(READPOWERSUPPLY);
+  if (busReadBit() == 0) ret = true;
+  busReset();
   return ret;
 }
 
@@ -306,29 +451,54 @@ bool DallasTemperature::setResolution(uint8_t index, uint8_t newResolution)
     // DS18S20 has a fixed 9-bit resolution
     if (sensors[index].address[0] != DS18S20MODEL)
     {
-      switch (newResolution)
-      {
-        case 12:
-          scratchPad[CONFIGURATION] = TEMP_12_BIT;
-          break;
-        case 11:
-          scratchPad[CONFIGURATION] = TEMP_11_BIT;
-          break;
-        case 10:
-          scratchPad[CONFIGURATION] = TEMP_10_BIT;
-          break;
-        case 9:
-        default:
-          scratchPad[CONFIGURATION] = TEMP_9_BIT;
-          break;
-      }
+      scratchPad[CONFIGURATION] = resolutionToConfig(newResolution);
       writeScratchPad(index, scratchPad);
+      sensors[index].resolution = configToResolution(scratchPad[CONFIGURATION]);
+      // the skip ROM wait has to cover the slowest device
+      if (sensors[index].resolution > bitResolution) bitResolution = sensors[index].resolution;
     }
 	return true;  // new value set
   }
   return false;
 }
 
+// returns the configuration register value for a resolution
+// if the resolution is out of range, 9 bits is used.
+uint8_t DallasTemperature::configToResolution(uint8_t configuration)
+{
+  switch (configuration)
+  {
+    case TEMP_12_BIT:
+      return 12;
+
+    case TEMP_11_BIT:
+      return 11;
+
+    case TEMP_10_BIT:
+      return 10;
+
+    case TEMP_9_BIT:
+      return 9;
+  }
+  return 0;
+}
+
+uint8_t DallasTemperature::resolutionToConfig(uint8_t newResolution)
+{
+  switch (newResolution)
+  {
+    case 12:
+      return TEMP_12_BIT;
+    case 11:
+      return TEMP_11_BIT;
+    case 10:
+      return TEMP_10_BIT;
+    case 9:
+    default:
+      return TEMP_9_BIT;
+  }
+}
+
 // returns the global resolution
 uint8_t DallasTemperature::getResolution()
 {
@@ -343,25 +513,23 @@ uint8_t DallasTemperature::getResolution(uint8_t index)
   if (sensors[index].address[0] == DS18S20MODEL) return 9; // this model has a fixed resolution
 
   ScratchPad scratchPad;
-  if (isConnected(index, scratchPad))
-  {
-	switch (scratchPad[CONFIGURATION])
-    {
-      case TEMP_12_BIT:
-        return 12;
-        
-      case TEMP_11_BIT:
-        return 11;
-        
-      case TEMP_10_BIT:
-        return 10;
-        
-      case TEMP_9_BIT:
-        return 9;
-        
-	}
-  }
-  return 0;
+  readScratchPad(index, scratchPad);
+  return scratchPadResolution(index, scratchPad);
+}
+
+uint8_t DallasTemperature::scratchPadResolution(uint8_t index, const uint8_t* scratchPad)
+{
+  if (sensors[index].address[0] == DS18S20MODEL) return 9; // this model has a fixed resolution
+  if (_wire->crc8(scratchPad, 8) != scratchPad[SCRATCHPAD_CRC]) return 0;
+  return configToResolution(scratchPad[CONFIGURATION]);
+}
+
+uint8_t DallasTemperature::conversionResolution(uint8_t index)
+{
+  // the DS18S20 takes as long as a 12 bit DS18B20 despite its 9 bits
+  if (sensors[index].address[0] == DS18S20MODEL) return 12;
+  if (sensors[index].resolution) return sensors[index].resolution;
+  return bitResolution;
 }
 
 
@@ -409,9 +577,49 @@ bool DallasTemperature::isConversionAvailable(uint8_t index)
 // sends command for all devices on the bus to perform a temperature conversion
 void DallasTemperature::requestTemperatures()
 {
-  _wire->reset();
-  _wire->skip();
-  _wire->write(STARTCONVO, parasite);
+#if REQUIRESSNAPSHOT
+  // the readings taken since the last request are a complete cycle
+  publishReadings();
+  conversionStarted = true;
+#endif
+
+  if (sequenceConversions())
+  {
+    // each parasite powered device needs the strong pullup held for its
+    // whole conversion, so this blocks even in ASYNC mode
+    int8_t index;
+    unsigned long externalStart = 0;
+    uint16_t externalTime = 0;
+    convertCursor = 0;
+    while ((index = nextConversion()) >= 0)
+    {
+      busReset();
+      busSelect(sensors[index].address);
+      busWrite(STARTCONVO, sensors[index].parasitePowered);
+
+      // each window is as long as that device's own conversion
+      uint8_t resolution = conversionResolution(index);
+      if (sensors[index].parasitePowered)
+      {
+        blockTillConversionComplete(&resolution, index);
+      }
+      else
+      {
+        externalStart = millis();
+        if (conversionTime(resolution) > externalTime) externalTime = conversionTime(resolution);
+      }
+    }
+    busReset();
+
+    // the externally powered devices started first may still be converting
+    unsigned long waited = millis() - externalStart;
+    if (waited < externalTime) delay(externalTime - waited);
+    return;
+  }
+
+  busReset();
+  busSkip();
+  busWrite(STARTCONVO, parasite);
 
   // ASYNC mode?
   if (!waitForConversion) return; 
@@ -420,6 +628,36 @@ void DallasTemperature::requestTemperatures()
   return;
 }
 
+// A skip ROM conversion starts every device at once, which is fastest but
+// has all parasite powered devices drawing from the pullup together. 1-Wire
+// can only address one device or all of them, so when that is over budget
+// the externally powered devices are started one by one (they need no
+// pullup and convert concurrently) and then each parasite powered device
+// gets a strong pullup window of its own.
+bool DallasTemperature::sequenceConversions(void)
+{
+  uint8_t parasites = 0;
+  for (uint8_t i = 0; i < devices; i++)
+  {
+    if (sensors[i].parasitePowered) parasites++;
+  }
+  return (uint32_t)parasites * CONVERSION_CURRENT > parasiteBudget;
+}
+
+// the conversion order is every externally powered device, then every
+// parasite powered one; convertCursor walks it across both passes
+int8_t DallasTemperature::nextConversion(void)
+{
+  while (convertCursor < 2 * devices)
+  {
+    uint8_t index = convertCursor % devices;
+    bool parasitePass = convertCursor >= devices;
+    convertCursor++;
+    if (sensors[index].parasitePowered == parasitePass) return index;
+  }
+  return -1;
+}
+
 void DallasTemperature::blockTillConversionComplete(uint8_t* bitResolution, uint8_t index)
 {
 	/*
@@ -433,23 +671,253 @@ void DallasTemperature::blockTillConversionComplete(uint8_t* bitResolution, uint
 	*/
 	
   	// Wait a fix number of cycles till conversion is complete (based on IC datasheet)
-	  switch (*bitResolution)
+	delay(conversionTime(*bitResolution));
+}
+
+// returns the worst case conversion time in ms (based on IC datasheet)
+uint16_t DallasTemperature::conversionTime(uint8_t bitResolution)
+{
+	  switch (bitResolution)
 	  {
 	    case 9:
-	      delay(94);
-	      break;
+	      return 94;
 	    case 10:
-	      delay(188);
-	      break;
+	      return 188;
 	    case 11:
-	      delay(375);
-	      break;
+	      return 375;
 	    case 12:
 	    default:
-	      delay(750);
-	      break;
+	      return 750;
 	  }
+}
+
+// queues a resolution change for tick(), which writes it right after the
+// device's next scratchpad read so the alarm bytes are preserved
+// returns false if there is no device at the given index
+bool DallasTemperature::scheduleResolution(uint8_t index, uint8_t newResolution)
+{
+  if (index >= devices) return false;
+  // DS18S20 has a fixed 9-bit resolution
+  if (sensors[index].address[0] == DS18S20MODEL) return true;
+  newResolution = constrain(newResolution, 9, 12);
+  pendingResolution[index] = newResolution;
+  // wait long enough for the slowest device in the next cycle
+  bitResolution = max(bitResolution, newResolution);
+  return true;
+}
+
+// Cooperative alternative to requestTemperatures()/readSensor(). Each call
+// runs bus steps (one reset or one byte each) until the next step's
+// measured cost would overrun the budget, and returns instead of waiting on
+// a conversion or EEPROM copy. Costs are learned per kind of step (reset,
+// write, read, ...) and a kind that has not run yet only runs as the first
+// step of a call. The first step of a call always runs, so a budget below
+// the cost of one step still makes progress.
+TickStatus DallasTemperature::tick(uint16_t budget)
+{
+  TickStatus status;
+  unsigned long start = micros();
+  bool first = true;
+
+  status.cycleComplete = false;
+  status.waitMicros = 0;
 
+  while (devices > 0)
+  {
+    // conversions and EEPROM copies finish on their own time
+    if (tickState == TICK_CONVERTING || tickState == TICK_COPY_WAIT)
+    {
+      unsigned long waited = micros() - tickStart;
+      if (waited < tickDelay)
+      {
+        status.waitMicros = tickDelay - waited;
+        break;
+      }
+    }
+
+    // a reset costs more than a byte, so costs are learned per kind of
+    // step rather than per state
+    uint8_t kind = tickStepKind();
+    unsigned long elapsed = micros() - start;
+    if (!first && elapsed + tickCost[kind] > budget) break;
+    first = false;
+
+    uint8_t state = tickState;
+    unsigned long stepStart = micros();
+    tickStep();
+    uint16_t cost = micros() - stepStart;
+
+    // track the slowest recent step, decaying so a single outlier does not
+    // starve the kind forever
+    if (tickCost[kind] == TICK_UNMEASURED) tickCost[kind] = cost;
+    tickCost[kind] -= tickCost[kind] >> 3;
+    if (cost > tickCost[kind]) tickCost[kind] = cost;
+
+    if (state != TICK_IDLE && tickState == TICK_IDLE)
+    {
+#if REQUIRESSNAPSHOT
+      publishReadings();
+#endif
+      status.cycleComplete = true;
+      break;
+    }
+  }
+
+  status.state = tickState;
+  status.progress = tickSensor;
+  return status;
+}
+
+// Sends the reset, ROM command, ROM bytes and function command that open
+// every tick() transaction, one of them per call; index -1 addresses every
+// device with skip ROM. Returns true once the function command has gone out.
+bool DallasTemperature::tickAddress(int8_t index, uint8_t command, uint8_t power)
+{
+  if (tickByte == 0) busReset();
+  else if (tickByte == 1) busWrite(index < 0 ? SKIPROM : MATCHROM);
+  else if (index >= 0 && tickByte < 10) busWrite(sensors[index].address[tickByte - 2]);
+  else
+  {
+    busWrite(command, power);
+    tickByte = 0;
+    return true;
+  }
+  tickByte++;
+  return false;
+}
+
+// Every step is at most one reset or one byte on the bus. Transactions are
+// not closed with a reset, the next one opens with its own.
+uint8_t DallasTemperature::tickStepKind(void)
+{
+  switch (tickState)
+  {
+    case TICK_START:
+    case TICK_SELECT:
+    case TICK_WRITE:
+    case TICK_COPY:
+      // see tickAddress()
+      return tickByte == 0 ? TICK_STEP_RESET : TICK_STEP_WRITE;
+
+    case TICK_READ:
+      return tickByte < sizeof(ScratchPad) - 1 ? TICK_STEP_READ : TICK_STEP_PROCESS;
+
+    case TICK_WRITE_DATA:
+      return TICK_STEP_WRITE;
+
+    default:
+      return TICK_STEP_NO_BUS;
+  }
+}
+
+void DallasTemperature::tickStep(void)
+{
+  switch (tickState)
+  {
+    case TICK_IDLE:
+      tickSensor = 0;
+      tickByte = 0;
+      tickExternalDelay = 0;
+      if (sequenceConversions())
+      {
+        convertCursor = 0;
+        tickConvert = nextConversion();
+      }
+      else
+      {
+        convertCursor = 2 * devices;
+        tickConvert = -1;
+      }
+      tickState = TICK_START;
+      return;
+
+    case TICK_START:
+    {
+      bool power = tickConvert < 0 ? parasite : sensors[tickConvert].parasitePowered;
+      if (!tickAddress(tickConvert, STARTCONVO, power)) return;
+#if REQUIRESSNAPSHOT
+      conversionStarted = true;
+#endif
+      uint8_t resolution = tickConvert < 0 ? bitResolution : conversionResolution(tickConvert);
+      unsigned long conversion = (unsigned long)conversionTime(resolution) * 1000;
+      tickStart = micros();
+      if (tickConvert >= 0 && !power)
+      {
+        // externally powered, start the next one while it converts
+        tickExternalStart = tickStart;
+        if (conversion > tickExternalDelay) tickExternalDelay = conversion;
+        tickConvert = nextConversion();
+        if (tickConvert >= 0) return;
+        conversion = 0;
+      }
+      // hold the strong pullup for the whole conversion
+      tickDelay = conversion;
+      tickState = TICK_CONVERTING;
+      return;
+    }
+
+    case TICK_CONVERTING:
+      // the next transaction's reset ends this pullup window
+      tickConvert = nextConversion();
+      if (tickConvert >= 0)
+      {
+        tickState = TICK_START;
+        return;
+      }
+      // wait for the externally powered devices started first, if need be
+      if (micros() - tickExternalStart < tickExternalDelay)
+      {
+        tickStart = tickExternalStart;
+        tickDelay = tickExternalDelay;
+        return;
+      }
+      tickState = TICK_SELECT;
+      return;
+
+    case TICK_SELECT:
+      if (tickAddress(tickSensor, READSCRATCH, 0)) tickState = TICK_READ;
+      return;
+
+    case TICK_READ:
+      tickPad[tickByte++] = busRead();
+      if (tickByte < sizeof(ScratchPad)) return;
+      tickByte = 0;
+      // skip devices that dropped off the bus rather than record garbage
+      if (_wire->crc8(tickPad, 8) != tickPad[SCRATCHPAD_CRC]) break;
+      processScratchPad(tickSensor, tickPad, 0xFF);
+      if (!pendingResolution[tickSensor]) break;
+      tickPad[CONFIGURATION] = resolutionToConfig(pendingResolution[tickSensor]);
+      pendingResolution[tickSensor] = 0;
+      tickState = TICK_WRITE;
+      return;
+
+    case TICK_WRITE:
+      if (tickAddress(tickSensor, WRITESCRATCH, 0)) tickState = TICK_WRITE_DATA;
+      return;
+
+    case TICK_WRITE_DATA:
+      busWrite(tickPad[HIGH_ALARM_TEMP + tickByte++]);
+      // DS18S20 does not use the configuration register
+      if (tickByte < (sensors[tickSensor].address[0] == DS18S20MODEL ? 2 : 3)) return;
+      tickByte = 0;
+      sensors[tickSensor].resolution = configToResolution(tickPad[CONFIGURATION]);
+      tickState = TICK_COPY;
+      return;
+
+    case TICK_COPY:
+      if (!tickAddress(tickSensor, COPYSCRATCH, sensors[tickSensor].parasitePowered)) return;
+      tickStart = micros();
+      tickDelay = sensors[tickSensor].parasitePowered ? 10000 : 0;
+      tickState = TICK_COPY_WAIT;
+      return;
+
+    case TICK_COPY_WAIT:
+      break;
+  }
+
+  // current device done, move on to the next or finish the cycle
+  tickSensor++;
+  tickState = tickSensor < devices ? TICK_SELECT : TICK_IDLE;
 }
 
 // reads scratchpad and returns the temperature in degrees C
@@ -513,6 +981,14 @@ float DallasTemperature::getTempF(uint8_t index)
   return toFahrenheit(getTempC(index));
 }
 
+// returns temperature in degrees C for the device with the given address
+float DallasTemperature::getTempByAddress(const uint8_t* deviceAddress)
+{
+  int8_t index = getIndex(deviceAddress);
+  if (index < 0) return DEVICE_DISCONNECTED;
+  return getTempC(index);
+}
+
 float DallasTemperature::getMaxTempC(uint8_t index) 
 {
 	if (index >= devices) index = 0;
@@ -537,6 +1013,195 @@ bool DallasTemperature::isParasitePowerMode(void)
   return parasite;
 }
 
+// returns true if the device at the given index is parasite powered
+bool DallasTemperature::isParasitePowered(uint8_t index)
+{
+  if (index >= devices) return false;
+  return sensors[index].parasitePowered;
+}
+
+// sets the current in microamps the pullup can supply during conversions
+// the default of 0xFFFF converts every device at once, as before
+void DallasTemperature::setParasiteBudget(uint16_t microamps)
+{
+  parasiteBudget = microamps;
+}
+
+uint16_t DallasTemperature::getParasiteBudget(void)
+{
+  return parasiteBudget;
+}
+
+#if REQUIRESSNAPSHOT
+
+// Seqlock over two buffers: the writer only ever touches the buffer readers
+// are not pointed at and flips readingSequence (a single byte, so the flip
+// itself cannot tear) once it is complete. Readers retry if it flipped
+// underneath them. An interrupt that reads while publishReadings() runs
+// sees the previous cycle rather than spinning.
+void DallasTemperature::publishReadings(void)
+{
+  uint8_t back = (readingSequence + 1) & 1;
+
+  for (uint8_t i = 0; i < devices; i++)
+  {
+    readings[back][i].currentTemp = sensors[i].currentTemp;
+    readings[back][i].minTemp = sensors[i].minTemp;
+    readings[back][i].maxTemp = sensors[i].maxTemp;
+    readings[back][i].avgTemp = sensors[i].avgTemp;
+    readings[back][i].faults = sensors[i].faults;
+    readingMeasured[back][i] = sensors[i].measured;
+  }
+  readingDevices[back] = devices;
+
+  READING_BARRIER();
+  readingSequence++;
+}
+
+bool DallasTemperature::getReading(uint8_t index, TemperatureReading* reading)
+{
+  uint8_t sequence;
+  bool found;
+
+  do
+  {
+    sequence = readingSequence;
+    READING_BARRIER();
+    found = index < readingDevices[sequence & 1] && readingMeasured[sequence & 1][index];
+    if (found) *reading = readings[sequence & 1][index];
+    READING_BARRIER();
+  } while (sequence != readingSequence);
+
+  return found;
+}
+
+uint8_t DallasTemperature::getReadingSequence(void)
+{
+  return readingSequence;
+}
+
+#endif
+
+// Bus access goes through these so REQUIRESTRACE can see every operation.
+// Without it they reduce to plain calls on _wire.
+
+// restarts the bus and the device search
+void DallasTemperature::busBegin(void)
+{
+  _wire->begin();
+  _wire->reset_search();
+  trace(TRACE_BEGIN, 0);
+}
+
+bool DallasTemperature::busSearch(uint8_t* deviceAddress)
+{
+  bool found = _wire->search(deviceAddress);
+  trace(TRACE_SEARCH, found);
+  // the ROM follows as one record per byte so a replay can reproduce it
+  if (found) for (uint8_t i = 0; i < 8; i++) trace(TRACE_ROM, deviceAddress[i]);
+  return found;
+}
+
+uint8_t DallasTemperature::busReset(void)
+{
+  uint8_t presence = _wire->reset();
+  trace(TRACE_RESET, presence);
+  return presence;
+}
+
+// the whole address follows the select, devices can share a crc byte
+void DallasTemperature::busSelect(const uint8_t* deviceAddress)
+{
+  _wire->select(deviceAddress);
+  trace(TRACE_SELECT, 0);
+  for (uint8_t i = 0; i < 8; i++) trace(TRACE_ROM, deviceAddress[i]);
+}
+
+void DallasTemperature::busSkip(void)
+{
+  _wire->skip();
+  trace(TRACE_SKIP, 0);
+}
+
+void DallasTemperature::busWrite(uint8_t value, uint8_t power)
+{
+  _wire->write(value, power);
+  trace(power ? TRACE_WRITE_POWER : TRACE_WRITE, value);
+}
+
+uint8_t DallasTemperature::busRead(void)
+{
+  uint8_t value = _wire->read();
+  trace(TRACE_READ, value);
+  return value;
+}
+
+uint8_t DallasTemperature::busReadBit(void)
+{
+  uint8_t value = _wire->read_bit();
+  trace(TRACE_READ_BIT, value);
+  return value;
+}
+
+#if REQUIRESTRACE
+
+// starts recording into the given buffer, NULL stops recording
+void DallasTemperature::setTraceBuffer(uint8_t* buffer, uint16_t size)
+{
+  traceBuffer = buffer;
+  traceSize = size - size % TRACE_RECORD_SIZE;
+  traceLength = 0;
+  traceDropped = 0;
+  traceLast = micros();
+}
+
+uint16_t DallasTemperature::getTraceLength(void)
+{
+  return traceLength;
+}
+
+uint16_t DallasTemperature::getTraceDropped(void)
+{
+  return traceDropped;
+}
+
+// appends one record: operation, data byte, and the microseconds since the
+// previous record as a little endian uint16_t. A longer gap gets a
+// TRACE_DELAY record in front carrying its upper 16 bits; the pair is
+// dropped together if it does not fit.
+void DallasTemperature::trace(uint8_t operation, uint8_t data)
+{
+  if (traceBuffer == NULL) return;
+
+  unsigned long now = micros();
+  unsigned long elapsed = now - traceLast;
+  uint16_t records = elapsed > 0xFFFF ? 2 : 1;
+  if (traceLength + records * TRACE_RECORD_SIZE > traceSize)
+  {
+    traceDropped++;
+    return;
+  }
+  traceLast = now;
+
+  uint8_t* record = traceBuffer + traceLength;
+  if (records == 2)
+  {
+    record[0] = TRACE_DELAY;
+    record[1] = 0;
+    record[2] = (elapsed >> 16) & 0xFF;
+    record[3] = (elapsed >> 24) & 0xFF;
+    record += TRACE_RECORD_SIZE;
+    traceLength += TRACE_RECORD_SIZE;
+  }
+  record[0] = operation;
+  record[1] = data;
+  record[2] = elapsed & 0xFF;
+  record[3] = (elapsed >> 8) & 0xFF;
+  traceLength += TRACE_RECORD_SIZE;
+}
+
+#endif
+
 // Convert float celsius to fahrenheit
 float DallasTemperature::toFahrenheit(float celsius)
 {
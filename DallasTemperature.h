@@ -13,6 +13,17 @@
 #define REQUIRESNEW false
 #endif
 
+// set to true to keep a double-buffered snapshot of the readings
+// that interrupts and other tasks can read without locking
+#ifndef REQUIRESSNAPSHOT
+#define REQUIRESSNAPSHOT true
+#endif
+
+// set to true to record every bus operation, see setTraceBuffer()
+#ifndef REQUIRESTRACE
+#define REQUIRESTRACE false
+#endif
+
 #include <inttypes.h>
 #include <DS2480B.h>
 
@@ -22,6 +33,8 @@
 #define DS1822MODEL  0x22
 
 // OneWire commands
+#define MATCHROM        0x55  // Addresses the device whose ROM follows
+#define SKIPROM         0xCC  // Addresses every device on the bus
 #define STARTCONVO      0x44  // Tells device to take a temperature reading and put it on the scratchpad
 #define COPYSCRATCH     0x48  // Copy EEPROM
 #define READSCRATCH     0xBE  // Read EEPROM
@@ -52,8 +65,65 @@
 
 #define MAX_DEVICES	6 //Max # of 1-wire temperature sensors to track.
 
+// Current a parasite powered device draws through the pullup while
+// converting, in microamps (DS18B20 datasheet maximum)
+#define CONVERSION_CURRENT 1500
+
+// Trace records are TRACE_RECORD_SIZE bytes: operation, data, and the
+// microseconds since the previous record (uint16_t, little endian). Longer
+// gaps are preceded by a TRACE_DELAY record holding the upper 16 bits.
+#define TRACE_RECORD_SIZE 4
+
+// Trace operations and their data byte
+#define TRACE_BEGIN       1 // bus begin and search reset, 0
+#define TRACE_SEARCH      2 // search, 1 if a device was found
+#define TRACE_ROM         3 // one byte of the address a search found or selected
+#define TRACE_RESET       4 // reset, 1 if a device answered
+#define TRACE_SELECT      5 // match ROM, 0, the address follows as 8 TRACE_ROM
+#define TRACE_SKIP        6 // skip ROM, 0
+#define TRACE_WRITE       7 // byte written
+#define TRACE_WRITE_POWER 8 // byte written followed by a strong pullup
+#define TRACE_READ        9 // byte read
+#define TRACE_READ_BIT   10 // bit read
+#define TRACE_DELAY      11 // 0, its time field is the next record's time >> 16
+
+// tick() states
+#define TICK_IDLE       0 // next step starts a conversion cycle
+#define TICK_START      1 // addressing a device (or all) to start converting
+#define TICK_CONVERTING 2 // waiting for the conversion to finish
+#define TICK_SELECT     3 // addressing the sensor to read
+#define TICK_READ       4 // reading the scratchpad, one byte per step
+#define TICK_WRITE      5 // addressing the sensor for a scheduled resolution
+#define TICK_WRITE_DATA 6 // writing the alarm and configuration bytes
+#define TICK_COPY       7 // addressing the sensor to copy to EEPROM
+#define TICK_COPY_WAIT  8 // waiting for the EEPROM copy to finish
+
+// kinds of tick() step, each with its own learned cost
+#define TICK_STEP_RESET   0 // bus reset
+#define TICK_STEP_WRITE   1 // one byte written
+#define TICK_STEP_READ    2 // one scratchpad byte read
+#define TICK_STEP_PROCESS 3 // last scratchpad byte read, then the stats update
+#define TICK_STEP_NO_BUS  4 // state change only
+#define TICK_STEP_KINDS   5
+
+#define TICK_UNMEASURED 0xFFFF // cost of a tick() step that has not run yet
+
 typedef uint8_t DeviceAddress[8];
 
+// Opaque reference to a sensor by ROM. Unlike an index it keeps
+// referring to the same device when begin() re-enumerates the bus.
+// The low HANDLE_SLOT_BITS pick the slot, the rest count how often the
+// slot has been given to another ROM.
+typedef uint8_t SensorHandle;
+#define INVALID_HANDLE   0xFF
+#define HANDLE_SLOT_BITS 3
+#define HANDLE_SLOT_MASK ((1 << HANDLE_SLOT_BITS) - 1)
+
+// slot HANDLE_SLOT_MASK is never used, so INVALID_HANDLE cannot be handed out
+#if MAX_DEVICES > HANDLE_SLOT_MASK
+#error "MAX_DEVICES does not fit in HANDLE_SLOT_BITS"
+#endif
+
 typedef struct 
 {
 	int16_t minTemp, maxTemp, avgTemp, currentTemp;	
@@ -63,9 +133,29 @@ typedef struct
 	int8_t lowTempFault;
 	int8_t highTempFault;
 	uint8_t faults;
+	bool parasitePowered;
+	uint8_t resolution; // 9-12 as last read or written, 0 if unknown
+#if REQUIRESSNAPSHOT
+	bool measured; // read since a conversion was started
+#endif
 	DeviceAddress address;
 } TemperatureSensor;
 
+// a device's readings as of the last publishReadings()
+typedef struct
+{
+	int16_t currentTemp, minTemp, maxTemp, avgTemp;
+	uint8_t faults;
+} TemperatureReading;
+
+typedef struct
+{
+	uint8_t state;         // TICK_* state the next call resumes in
+	uint8_t progress;      // sensors read so far in the current cycle
+	bool cycleComplete;    // true on the call that read the last sensor
+	uint32_t waitMicros;   // time until the next step is due, 0 if work is pending
+} TickStatus;
+
 class DallasTemperature
 {
   public:
@@ -84,6 +174,24 @@ class DallasTemperature
   // returns true if address is valid
   bool validAddress(uint8_t*);
 
+  // copies the address of the device at the given index, false if there is none
+  bool getAddress(uint8_t*, uint8_t);
+
+  // returns the index of the device with the given address, -1 if not on the bus
+  int8_t getIndex(const uint8_t*);
+
+  // returns a handle for the given address that survives re-enumeration.
+  // There are MAX_DEVICES slots; when they are all in use, the slot of a
+  // device missing from the last begin() is reassigned and the handles
+  // issued for it go stale. INVALID_HANDLE if every slot belongs to a
+  // device that is still present.
+  SensorHandle getHandle(const uint8_t*);
+
+  // returns the current index of the device behind a handle, -1 if it is
+  // not on the bus or the handle is stale. A slot has to be reassigned 32
+  // times before a stale handle matches again.
+  int8_t getIndexByHandle(SensorHandle);
+
   bool readSensor(uint8_t, uint8_t debug = 0xFF);
   
   // attempt to determine if the device at the given address is connected to the bus
@@ -125,12 +233,23 @@ class DallasTemperature
   // sends command for all devices on the bus to perform a temperature conversion 
   void requestTemperatures(void);
 
+  // advances the conversion / read / configure cycle by as many bus steps
+  // as fit in the given number of microseconds, never waiting on the bus
+  TickStatus tick(uint16_t);
+
+  // queues a resolution change that tick() writes after the device's next read
+  bool scheduleResolution(uint8_t, uint8_t);
+
   // returns temperature in degrees C
   float getTempC(uint8_t);
 
   // returns temperature in degrees F
   float getTempF(uint8_t);
 
+  // returns temperature in degrees C for the device with the given address
+  // or DEVICE_DISCONNECTED if it was not found by begin()
+  float getTempByAddress(const uint8_t*);
+
   float getMaxTempC(uint8_t);
   float getMinTempC(uint8_t);
   float getAvgTempC(uint8_t);
@@ -149,9 +268,55 @@ class DallasTemperature
   
   // returns true if the bus requires parasite power
   bool isParasitePowerMode(void);
+
+  // returns true if the device at the given index is parasite powered
+  bool isParasitePowered(uint8_t);
+
+  // sets/gets the current in microamps the pullup can supply to parasite
+  // powered devices converting at the same time. Once that sequences the
+  // conversions, requestTemperatures() blocks for each parasite powered
+  // device even in ASYNC mode; tick() does not
+  void setParasiteBudget(uint16_t);
+  uint16_t getParasiteBudget(void);
   
   bool isConversionAvailable(uint8_t);
 
+  #if REQUIRESSNAPSHOT
+
+  // makes the current readings of all devices visible to getReading()
+  void publishReadings(void);
+
+  // copies the last published readings of a device, safe to call from an
+  // interrupt or another task while the bus is being read, unlike
+  // getCelsius() and the other getters. begin(), requestTemperatures() and
+  // every completed tick() cycle publish. requestTemperatures() publishes
+  // what readSensor() read in the previous cycle, so in blocking mode the
+  // snapshot lags one cycle unless publishReadings() is called after the
+  // readSensor() loop.
+  // returns false if no device was published at the given index, or if the
+  // device has not been read since a conversion (its scratchpad still
+  // holds the 85C power on value)
+  bool getReading(uint8_t, TemperatureReading*);
+
+  // incremented by every publishReadings()
+  uint8_t getReadingSequence(void);
+
+  #endif
+
+  #if REQUIRESTRACE
+
+  // records every bus operation into the given buffer until it is full,
+  // NULL stops recording
+  void setTraceBuffer(uint8_t*, uint16_t);
+
+  // bytes of the trace buffer in use
+  uint16_t getTraceLength(void);
+
+  // operations that did not fit in the trace buffer
+  uint16_t getTraceDropped(void);
+
+  #endif
+
   // convert from celcius to farenheit
   static float toFahrenheit(const float);
 
@@ -168,6 +333,11 @@ class DallasTemperature
   
   #endif
 
+  protected:
+
+  // reads scratchpad and returns the temperature in degrees C
+  float calculateTemperature(uint8_t, uint8_t*);
+
   private:
   typedef uint8_t ScratchPad[9];
 
@@ -176,6 +346,9 @@ class DallasTemperature
   // parasite power on or off
   bool parasite;
 
+  // see setParasiteBudget()
+  uint16_t parasiteBudget;
+
   // used to determine the delay amount needed to allow for the
   // temperature conversion to take place
   uint8_t bitResolution;
@@ -188,14 +361,126 @@ class DallasTemperature
   
   // count of devices on the bus
   uint8_t devices;
+
+  // device indices sorted by address, rebuilt by begin() for getIndex()
+  uint8_t romIndex[MAX_DEVICES];
+
+  // addresses handed out as handles, and the handle currently naming each
+  // slot; kept across begin()
+  DeviceAddress handleAddress[MAX_DEVICES];
+  SensorHandle handleIssued[MAX_DEVICES];
+  uint8_t handles;
+
+  // tick() state machine
+  uint8_t tickState;
+  uint8_t tickSensor;
+  uint8_t tickByte;
+  int8_t tickConvert;
+  ScratchPad tickPad;
+  unsigned long tickStart;
+  unsigned long tickDelay;
+  // when the last externally powered device of a sequenced cycle was
+  // started, and the longest conversion among them in microseconds
+  unsigned long tickExternalStart;
+  unsigned long tickExternalDelay;
+  uint16_t tickCost[TICK_STEP_KINDS];
+
+  // next entry of the conversion order walked by startNextConversion(),
+  // 2 * devices when no sequenced cycle is in progress
+  uint8_t convertCursor;
+
+  // resolution tick() should write to each device, 0 for none
+  uint8_t pendingResolution[MAX_DEVICES];
+
+  #if REQUIRESTRACE
+
+  uint8_t* traceBuffer;
+  uint16_t traceSize;
+  uint16_t traceLength;
+  uint16_t traceDropped;
+  unsigned long traceLast;
+
+  // appends a record to the trace buffer
+  void trace(uint8_t, uint8_t);
+
+  #else
+
+  void trace(uint8_t, uint8_t) {}
+
+  #endif
+
+  #if REQUIRESSNAPSHOT
+
+  // published readings, readers use buffer (readingSequence & 1) while
+  // publishReadings() fills the other one
+  TemperatureReading readings[2][MAX_DEVICES];
+  bool readingMeasured[2][MAX_DEVICES];
+  uint8_t readingDevices[2];
+
+  // a conversion has been started since begin()
+  bool conversionStarted;
+  volatile uint8_t readingSequence;
+
+  #endif
   
   // Take a pointer to one wire instance
   DS2480B* _wire;
 
-  // reads scratchpad and returns the temperature in degrees C
-  float calculateTemperature(uint8_t, uint8_t*);
-  
   void	blockTillConversionComplete(uint8_t*,uint8_t);
+
+  // updates the device's readings and stats from a scratchpad read off the bus
+  void processScratchPad(uint8_t, const uint8_t*, uint8_t);
+
+  // returns the resolution a scratchpad read from the device reports, 0 if
+  // the scratchpad is corrupt
+  uint8_t scratchPadResolution(uint8_t, const uint8_t*);
+
+  // returns the resolution whose conversion time covers the device's own
+  // conversion, for sizing its strong pullup window
+  uint8_t conversionResolution(uint8_t);
+
+  // sends the alarm and configuration bytes without copying them to EEPROM
+  void sendScratchPad(uint8_t, const uint8_t*);
+
+  // true if the parasite powered devices would overrun the parasite budget
+  // converting together and have to be started one at a time
+  bool sequenceConversions(void);
+
+  // returns the next device to start in a sequenced cycle, -1 once every
+  // device has been started
+  int8_t nextConversion(void);
+
+  // runs one step of addressing a device for tick()
+  bool tickAddress(int8_t, uint8_t, uint8_t);
+
+  // returns the TICK_STEP_* kind of the next tick() step
+  uint8_t tickStepKind(void);
+
+  // runs a single tick() step
+  void tickStep(void);
+
+  // returns the configuration register value for 9, 10, 11, or 12 bits
+  static uint8_t resolutionToConfig(uint8_t);
+
+  // returns 9, 10, 11, or 12 bits for a configuration register value, 0 if
+  // it is not one
+  static uint8_t configToResolution(uint8_t);
+
+  // returns the worst case conversion time in ms for 9, 10, 11, or 12 bits
+  static uint16_t conversionTime(uint8_t);
+
+  // bus operations, recorded when REQUIRESTRACE is set
+  void busBegin(void);
+  bool busSearch(uint8_t*);
+  uint8_t busReset(void);
+  void busSelect(const uint8_t*);
+  void busSkip(void);
+  void busWrite(uint8_t, uint8_t power = 0);
+  uint8_t busRead(void);
+  uint8_t busReadBit(void);
+
+  // sorts romIndex by address
+  void buildRomIndex(void);
     
 };
 #endif
@@ -0,0 +1,56 @@
+// Records the bus traffic of begin() and one blocking read cycle and prints
+// it as hex, for replay on a PC with extras/TraceReplay:
+//
+//   xxd -r -p capture.txt trace.bin
+//   ./TraceReplay trace.bin blocking 1
+//
+// Set REQUIRESTRACE to true in DallasTemperature.h before building.
+#include <DS2480B.h>
+#include <DallasTemperature.h>
+#include <AltSoftSerial.h>
+
+#if !REQUIRESTRACE
+#error "Set REQUIRESTRACE to true in DallasTemperature.h"
+#endif
+
+AltSoftSerial altSerial; //pins 8 and 9
+
+DS2480B ds(altSerial);
+
+DallasTemperature sensors(&ds);
+
+// 4 bytes per bus operation (36 for a select), enough for begin() and a
+// cycle on two sensors
+uint8_t traceBuffer[1024];
+
+void setup(void)
+{
+  // start serial port
+  Serial.begin(9600);
+  altSerial.begin(9600);
+
+  sensors.setTraceBuffer(traceBuffer, sizeof(traceBuffer));
+
+  sensors.begin();
+  sensors.requestTemperatures();
+  for (uint8_t i = 0; i < sensors.getDeviceCount(); i++) sensors.readSensor(i);
+
+  if (sensors.getTraceDropped() > 0)
+  {
+    Serial.print("Trace buffer too small, dropped ");
+    Serial.print(sensors.getTraceDropped());
+    Serial.println(" operations");
+  }
+
+  for (uint16_t i = 0; i < sensors.getTraceLength(); i++)
+  {
+    if (traceBuffer[i] < 0x10) Serial.print('0');
+    Serial.print(traceBuffer[i], HEX);
+    if (i % 32 == 31) Serial.println();
+  }
+  Serial.println();
+}
+
+void loop(void)
+{
+}
@@ -0,0 +1,336 @@
+// Measures DallasTemperature on Linux against a simulated bus (DS2480B.h)
+// and checks its temperature decoding against datasheet values.
+//
+// Build on Linux from the library root:
+//   g++ -O2 -DARDUINO=100 -DREQUIRESTRACE=true -Iextras/Host -Iextras/Benchmark
+//       -I. DallasTemperature.cpp extras/Benchmark/DS2480B.cpp
+//       extras/Benchmark/Benchmark.cpp -o Benchmark
+//
+// Usage: Benchmark [iterations]
+//
+// Output is one JSON object per line, "bench" names the measurement:
+//   footprint  RAM used by the library and by each tracked sensor (host
+//              sizes, AVR packs tighter)
+//   decode     one golden vector per model, resolution and temperature:
+//              the datasheet value next to what readScratchPad() (via
+//              getCelsius()) and calculateTemperature() make of the same
+//              scratchpad; decode_summary counts the mismatches, telling
+//              the known readScratchPad() failures from unexpected ones
+//   read       CPU time and bus time of readScratchPad() stopped after each
+//              processing stage; stats_update is the cost of the stages
+//              on top of the bare bus read
+//   begin      bus transactions and bus time of begin() per device count
+//   tick       calls and the longest call of tick(budget) over a few cycles
+//              with sequenced parasite conversions and a resolution change;
+//              overruns counts calls that took longer than the budget
+//
+// Bus time is virtual, using standard speed 1-Wire slot timings. CPU
+// time is wall clock time of the simulated calls. The exit status is 1 if
+// calculateTemperature() gets any vector wrong, readScratchPad() gets one
+// wrong that is not a known failure, or tick() overruns a budget, and 2 if
+// the tool cannot run.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include "DS2480B.h"
+#include "DallasTemperature.h"
+#include "Arduino.h"
+
+unsigned long hostClock = 0;
+
+// exposes the decoder the library keeps for itself
+class BenchTemperature : public DallasTemperature
+{
+  public:
+
+  BenchTemperature(DS2480B* wire) : DallasTemperature(wire) {}
+
+  using DallasTemperature::calculateTemperature;
+};
+
+typedef struct
+{
+  uint8_t family;
+  const char* name;
+} Model;
+
+static const Model models[] =
+{
+  { DS18B20MODEL, "DS18B20" },
+  { DS1822MODEL, "DS1822" },
+  { DS18S20MODEL, "DS18S20" },
+};
+
+// DS18B20/DS1822 datasheet table, 12 bit readings in 1/16 C
+static const int16_t goldenRaw[] =
+{
+  0x07D0, // +125
+  0x0550, // +85
+  0x0191, // +25.0625
+  0x00A2, // +10.125
+  0x0008, // +0.5
+  0x0000, // 0
+  (int16_t)0xFFF8, // -0.5
+  (int16_t)0xFF5E, // -10.125
+  (int16_t)0xFE6F, // -25.0625
+  (int16_t)0xFC90, // -55
+};
+
+// DS18S20 extended resolution temperatures
+static const float goldenS20[] = { 85.0f, 25.0625f, 10.125f, 0.5f, 0.0f, -0.5f, -10.125f, -25.0625f, -55.0f };
+
+static const uint8_t resolutionConfig[] = { TEMP_9_BIT, TEMP_10_BIT, TEMP_11_BIT, TEMP_12_BIT };
+
+// readScratchPad() decodes every model with the DS18B20 scale and adds 55C
+// to readings below -30C (the offset in processScratchPad()), so these
+// vectors are expected to fail until the decoder is fixed
+static bool knownFailure(const Model* model, float expected)
+{
+  return model->family == DS18S20MODEL || expected < -30.0f;
+}
+
+static const char* operationNames[] =
+{
+  "unknown", "begin", "search", "rom", "reset", "select",
+  "skip", "write", "write_power", "read", "read_bit", "delay"
+};
+#define OPERATIONS (sizeof(operationNames) / sizeof(operationNames[0]))
+
+static uint8_t traceBuffer[65532];
+
+static const char* json(bool value)
+{
+  return value ? "true" : "false";
+}
+
+static double nanoseconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void footprint(void)
+{
+  size_t perSensor = sizeof(TemperatureSensor)
+    + sizeof(DeviceAddress) // handle
+    + 2;                    // romIndex, pendingResolution
+#if REQUIRESSNAPSHOT
+  perSensor += 2 * (sizeof(TemperatureReading) + sizeof(bool)); // readings, readingMeasured
+#endif
+
+  printf("{\"bench\":\"footprint\",\"max_devices\":%d,\"sizeof_DallasTemperature\":%zu,"
+    "\"sizeof_TemperatureSensor\":%zu,\"sizeof_TemperatureReading\":%zu,\"per_sensor_bytes\":%zu,"
+    "\"snapshot\":%s,\"trace\":%s}\n",
+    MAX_DEVICES, sizeof(DallasTemperature), sizeof(TemperatureSensor), sizeof(TemperatureReading),
+    perSensor, json(REQUIRESSNAPSHOT), json(REQUIRESTRACE));
+}
+
+// decodes one scratchpad both ways and reports it against the expected value
+static void decodeVector(DS2480B* wire, BenchTemperature* sensors, const Model* model, uint8_t resolution,
+  int16_t raw, uint8_t countRemain, float expected, unsigned* knownMismatches, unsigned* unexpectedMismatches,
+  unsigned* calculateMismatches)
+{
+  wire->clear();
+  wire->add(model->family, 1);
+  wire->setTemperature(0, raw, resolutionConfig[resolution - 9], countRemain);
+  sensors->begin();
+
+  uint8_t scratchPad[9];
+  sensors->readScratchPad(0, scratchPad);
+  float fromScratchPad = sensors->getCelsius(0) / 100.0f;
+  float calculated = sensors->calculateTemperature(0, scratchPad);
+
+  // getCelsius() only has hundredths
+  bool scratchPadOk = fabs(fromScratchPad - expected) < 0.01f;
+  bool calculateOk = fabs(calculated - expected) < 0.0001f;
+  bool known = knownFailure(model, expected);
+  if (!scratchPadOk) (*(known ? knownMismatches : unexpectedMismatches))++;
+  if (!calculateOk) (*calculateMismatches)++;
+
+  printf("{\"bench\":\"decode\",\"model\":\"%s\",\"resolution\":%d,\"raw\":\"0x%04X\",\"count_remain\":%d,"
+    "\"expected\":%.4f,\"readScratchPad\":%.4f,\"calculateTemperature\":%.4f,"
+    "\"readScratchPad_ok\":%s,\"readScratchPad_known_failure\":%s,\"calculateTemperature_ok\":%s}\n",
+    model->name, resolution, (uint16_t)raw, countRemain, expected, fromScratchPad, calculated,
+    json(scratchPadOk), json(known), json(calculateOk));
+}
+
+// returns false on any mismatch that is not a known failure
+static bool decode(DS2480B* wire, BenchTemperature* sensors)
+{
+  unsigned vectors = 0;
+  unsigned knownMismatches = 0;
+  unsigned unexpectedMismatches = 0;
+  unsigned calculateMismatches = 0;
+
+  for (size_t m = 0; m < sizeof(models) / sizeof(models[0]); m++)
+  {
+    const Model* model = &models[m];
+
+    if (model->family == DS18S20MODEL)
+    {
+      // TEMPERATURE = TEMP_READ - 0.25 + (COUNT_PER_C - COUNT_REMAIN) / COUNT_PER_C
+      for (size_t i = 0; i < sizeof(goldenS20) / sizeof(goldenS20[0]); i++)
+      {
+        float temperature = goldenS20[i];
+        int16_t whole = floorf(temperature + 0.25f);
+        uint8_t countRemain = 16 - (uint8_t)((temperature + 0.25f - whole) * 16);
+        int16_t raw = floorf(temperature * 2 + 0.5f);
+        decodeVector(wire, sensors, model, 9, raw, countRemain, temperature,
+          &knownMismatches, &unexpectedMismatches, &calculateMismatches);
+        vectors++;
+      }
+      continue;
+    }
+
+    for (uint8_t resolution = 9; resolution <= 12; resolution++)
+    {
+      // the undefined low bits of shorter conversions read as 0
+      int16_t mask = ~((1 << (12 - resolution)) - 1);
+      for (size_t i = 0; i < sizeof(goldenRaw) / sizeof(goldenRaw[0]); i++)
+      {
+        int16_t raw = goldenRaw[i] & mask;
+        decodeVector(wire, sensors, model, resolution, raw, 0x0C, raw / 16.0f,
+          &knownMismatches, &unexpectedMismatches, &calculateMismatches);
+        vectors++;
+      }
+    }
+  }
+
+  printf("{\"bench\":\"decode_summary\",\"vectors\":%u,\"readScratchPad_mismatches\":%u,"
+    "\"readScratchPad_known_failures\":%u,\"readScratchPad_unexpected\":%u,"
+    "\"calculateTemperature_mismatches\":%u}\n",
+    vectors, knownMismatches + unexpectedMismatches, knownMismatches, unexpectedMismatches,
+    calculateMismatches);
+  return unexpectedMismatches == 0 && calculateMismatches == 0;
+}
+
+static void readCost(DS2480B* wire, BenchTemperature* sensors, long iterations)
+{
+  static const char* stages[] = { "", "bus", "raw", "current", "min_max_faults", "average" };
+  double perRead[6];
+  uint8_t scratchPad[9];
+
+  wire->clear();
+  wire->add(DS18B20MODEL, 1);
+  wire->setTemperature(0, 0x0191, TEMP_12_BIT, 0x0C);
+  sensors->begin();
+
+  for (uint8_t debug = 1; debug <= 5; debug++)
+  {
+    unsigned long bus = hostClock;
+    sensors->readScratchPad(0, scratchPad, debug);
+    bus = hostClock - bus;
+
+    // best of a few runs, the stages differ by less than the scheduling noise
+    perRead[debug] = 0;
+    for (uint8_t run = 0; run < 5; run++)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (long i = 0; i < iterations; i++) sensors->readScratchPad(0, scratchPad, debug);
+      double ns = nanoseconds(start) / iterations;
+      if (run == 0 || ns < perRead[debug]) perRead[debug] = ns;
+    }
+
+    printf("{\"bench\":\"read\",\"debug\":%d,\"stage\":\"%s\",\"iterations\":%ld,"
+      "\"ns_per_read\":%.2f,\"bus_us_per_read\":%lu}\n",
+      debug, stages[debug], iterations, perRead[debug], bus);
+  }
+
+  printf("{\"bench\":\"stats_update\",\"ns_per_reading\":%.2f}\n", perRead[5] - perRead[1]);
+}
+
+static void beginCost(DS2480B* wire, BenchTemperature* sensors)
+{
+  for (uint8_t devices = 1; devices <= MAX_DEVICES; devices++)
+  {
+    wire->clear();
+    for (uint8_t i = 0; i < devices; i++) wire->add(DS18B20MODEL, i + 1);
+
+    sensors->setTraceBuffer(traceBuffer, sizeof(traceBuffer));
+    unsigned long bus = hostClock;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    sensors->begin();
+    double ns = nanoseconds(start);
+    bus = hostClock - bus;
+
+    unsigned long operations[OPERATIONS] = { 0 };
+    for (uint16_t i = 0; i < sensors->getTraceLength(); i += TRACE_RECORD_SIZE)
+    {
+      uint8_t operation = traceBuffer[i];
+      operations[operation < OPERATIONS ? operation : 0]++;
+    }
+    sensors->setTraceBuffer(NULL, 0);
+
+    printf("{\"bench\":\"begin\",\"devices\":%d,\"found\":%d,\"bus_us\":%lu,\"bus_us_per_device\":%lu,\"ns\":%.0f",
+      devices, sensors->getDeviceCount(), bus, bus / devices, ns);
+    for (size_t i = 1; i < OPERATIONS; i++) printf(",\"%s\":%lu", operationNames[i], operations[i]);
+    printf("}\n");
+  }
+}
+
+// every budget is above the slowest single step (a reset), so a call that
+// takes longer than its budget ran a step it should have left for later;
+// returns false if any did
+static bool tickBudget(DS2480B* wire)
+{
+  static const uint16_t budgets[] = { 1000, 1200, 1500, 1800, 2500, 4000, 5600 };
+  bool kept = true;
+
+  for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++)
+  {
+    wire->clear();
+    for (uint8_t i = 0; i < 4; i++) wire->add(DS18B20MODEL, i + 1, i < 2);
+
+    // a fresh instance, so the costs are learned from scratch
+    DallasTemperature sensors(wire);
+    sensors.begin();
+    sensors.setParasiteBudget(CONVERSION_CURRENT);
+    sensors.scheduleResolution(3, 10);
+
+    unsigned long calls = 0;
+    unsigned long worst = 0;
+    unsigned long overruns = 0;
+    for (uint8_t cycle = 0; cycle < 5; cycle++)
+    {
+      TickStatus status;
+      do
+      {
+        unsigned long start = hostClock;
+        status = sensors.tick(budgets[b]);
+        unsigned long took = hostClock - start;
+        calls++;
+        if (took > worst) worst = took;
+        if (took > budgets[b]) overruns++;
+        // the sketch's other work, or sleeping until the next step is due
+        hostClock += status.waitMicros > 0 ? status.waitMicros : 100;
+      } while (!status.cycleComplete);
+    }
+    if (overruns > 0) kept = false;
+
+    printf("{\"bench\":\"tick\",\"budget_us\":%u,\"devices\":%d,\"cycles\":5,\"calls\":%lu,"
+      "\"worst_us\":%lu,\"overruns\":%lu}\n",
+      budgets[b], sensors.getDeviceCount(), calls, worst, overruns);
+  }
+  return kept;
+}
+
+int main(int argc, char** argv)
+{
+  long iterations = argc > 1 ? atol(argv[1]) : 100000;
+  if (iterations <= 0)
+  {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return 2;
+  }
+
+  DS2480B wire;
+  BenchTemperature sensors(&wire);
+
+  footprint();
+  bool decoded = decode(&wire, &sensors);
+  readCost(&wire, &sensors, iterations);
+  beginCost(&wire, &sensors);
+  bool kept = tickBudget(&wire);
+  return decoded && kept ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+// Simulated DS2480B bus, see DS2480B.h
+
+#include "DS2480B.h"
+#include "DallasTemperature.h"
+#include "Arduino.h"
+#include "Crc8.h"
+
+DS2480B::DS2480B()
+{
+  clear();
+}
+
+void DS2480B::clear(void)
+{
+  count = 0;
+  found = 0;
+  idle();
+}
+
+uint8_t DS2480B::add(uint8_t family, uint8_t id, bool parasite)
+{
+  SimulatedDevice* device = &devices[count];
+
+  memset(device->rom, 0, sizeof(device->rom));
+  device->rom[0] = family;
+  device->rom[1] = id;
+  device->rom[7] = crc8(device->rom, 7);
+  device->parasite = parasite;
+
+  // power on defaults: 85C, 12 bit
+  setTemperature(count, family == DS18S20MODEL ? 0x00AA : 0x0550, TEMP_12_BIT, 0x0C);
+  return count++;
+}
+
+void DS2480B::setTemperature(uint8_t position, int16_t raw, uint8_t configuration, uint8_t countRemain)
+{
+  SimulatedDevice* device = &devices[position];
+
+  device->scratchPad[TEMP_LSB] = raw & 0xFF;
+  device->scratchPad[TEMP_MSB] = (raw >> 8) & 0xFF;
+  device->scratchPad[HIGH_ALARM_TEMP] = 75;
+  device->scratchPad[LOW_ALARM_TEMP] = 70;
+  // the DS18S20 has no configuration register and reads 0xFF there
+  device->scratchPad[CONFIGURATION] = device->rom[0] == DS18S20MODEL ? 0xFF : configuration;
+  device->scratchPad[INTERNAL_BYTE] = 0xFF;
+  device->scratchPad[COUNT_REMAIN] = countRemain;
+  device->scratchPad[COUNT_PER_C] = 0x10;
+  updateCrc(device);
+}
+
+void DS2480B::updateCrc(SimulatedDevice* device)
+{
+  device->scratchPad[SCRATCHPAD_CRC] = crc8(device->scratchPad, 8);
+}
+
+void DS2480B::begin(void)
+{
+}
+
+void DS2480B::reset_search(void)
+{
+  found = 0;
+}
+
+// devices are found in the order they were added; a search costs the
+// SEARCH ROM command plus three slots per ROM bit
+uint8_t DS2480B::search(uint8_t* newAddr)
+{
+  reset();
+  hostClock += 8 * BUS_SLOT_US + 64 * 3 * BUS_SLOT_US;
+  if (found >= count) return 0;
+  memcpy(newAddr, devices[found++].rom, 8);
+  return 1;
+}
+
+uint8_t DS2480B::reset(void)
+{
+  hostClock += BUS_RESET_US;
+  idle();
+  return count > 0;
+}
+
+// forgets the selection and command, as a reset does
+void DS2480B::idle(void)
+{
+  selected = -1;
+  addressed = false;
+  matched = 8;
+  command = -1;
+  written = 0;
+  replyLength = 0;
+  replied = 0;
+}
+
+void DS2480B::select(const uint8_t* rom)
+{
+  hostClock += 9 * 8 * BUS_SLOT_US;
+  match(rom);
+}
+
+void DS2480B::skip(void)
+{
+  hostClock += 8 * BUS_SLOT_US;
+  selected = -2;
+  addressed = true;
+}
+
+void DS2480B::match(const uint8_t* rom)
+{
+  selected = -1;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (memcmp(devices[i].rom, rom, 8) == 0) selected = i;
+  }
+  addressed = true;
+}
+
+void DS2480B::write(uint8_t v, uint8_t power)
+{
+  (void)power;
+  hostClock += 8 * BUS_SLOT_US;
+
+  // ROM commands may also arrive as plain bytes, as tick() sends them
+  if (matched < 8)
+  {
+    rom[matched++] = v;
+    if (matched == 8) match(rom);
+    return;
+  }
+  if (!addressed)
+  {
+    if (v == MATCHROM) matched = 0;
+    if (v == SKIPROM)
+    {
+      selected = -2;
+      addressed = true;
+    }
+    return;
+  }
+
+  if (command < 0)
+  {
+    command = v;
+    if (selected < 0) return;
+    SimulatedDevice* device = &devices[selected];
+    switch (v)
+    {
+      case READSCRATCH:
+        memcpy(reply, device->scratchPad, 9);
+        replyLength = 9;
+        break;
+      case READPOWERSUPPLY:
+        reply[0] = device->parasite ? 0 : 1;
+        replyLength = 1;
+        break;
+    }
+    return;
+  }
+
+  // WRITESCRATCH fills the alarm bytes, then the configuration register
+  if (command == WRITESCRATCH && selected >= 0 && written < 3)
+  {
+    SimulatedDevice* device = &devices[selected];
+    if (written < 2 || device->rom[0] != DS18S20MODEL) device->scratchPad[HIGH_ALARM_TEMP + written] = v;
+    written++;
+    updateCrc(device);
+  }
+}
+
+// an idle bus reads as all ones
+uint8_t DS2480B::next(void)
+{
+  if (replied < replyLength) return reply[replied++];
+  return 0xFF;
+}
+
+uint8_t DS2480B::read(void)
+{
+  hostClock += 8 * BUS_SLOT_US;
+  return next();
+}
+
+uint8_t DS2480B::read_bit(void)
+{
+  hostClock += BUS_SLOT_US;
+  return next() & 0x01;
+}
+
+uint8_t DS2480B::crc8(const uint8_t* addr, uint8_t len)
+{
+  return hostCrc8(addr, len);
+}
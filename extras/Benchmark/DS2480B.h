@@ -0,0 +1,77 @@
+// Host stand-in for the DS2480B driver that simulates a bus of DS18B20,
+// DS18S20 and DS1822 devices for Benchmark.
+//
+// Devices answer READSCRATCH, WRITESCRATCH, COPYSCRATCH and READPOWERSUPPLY;
+// STARTCONVO is accepted and ignored, the scratchpad holds whatever
+// setTemperature() put there. Every operation advances the virtual clock by
+// its standard speed 1-Wire duration so bus time can be compared.
+
+#ifndef DS2480B_h
+#define DS2480B_h
+
+#include <stdint.h>
+
+// standard speed timings in microseconds
+#define BUS_RESET_US 960 // reset pulse and presence detect
+#define BUS_SLOT_US   70 // one read or write time slot
+
+#define SIMULATED_DEVICES 16
+
+typedef struct
+{
+  uint8_t rom[8];
+  uint8_t scratchPad[9];
+  bool parasite;
+} SimulatedDevice;
+
+class DS2480B
+{
+  public:
+
+  DS2480B();
+
+  // removes every device from the bus
+  void clear(void);
+
+  // adds a device of the given family, returns its position on the bus
+  uint8_t add(uint8_t, uint8_t, bool parasite = false);
+
+  // loads a raw temperature, configuration register and COUNT_REMAIN
+  void setTemperature(uint8_t, int16_t, uint8_t, uint8_t);
+
+  void begin(void);
+  void reset_search(void);
+  uint8_t search(uint8_t*);
+  uint8_t reset(void);
+  void select(const uint8_t*);
+  void skip(void);
+  void write(uint8_t, uint8_t power = 0);
+  uint8_t read(void);
+  uint8_t read_bit(void);
+
+  static uint8_t crc8(const uint8_t*, uint8_t);
+
+  private:
+
+  SimulatedDevice devices[SIMULATED_DEVICES];
+  uint8_t count;
+
+  // bus state since the last reset
+  uint8_t found;
+  bool addressed;    // ROM command done
+  uint8_t rom[8];    // ROM bytes following a MATCHROM byte
+  uint8_t matched;   // ROM bytes received, 8 when not matching
+  int8_t selected;   // -1 none, -2 all (skip ROM)
+  int16_t command;   // -1 until the function command arrives
+  uint8_t written;   // bytes written after the command
+  uint8_t reply[9];
+  uint8_t replyLength;
+  uint8_t replied;
+
+  void idle(void);
+  void match(const uint8_t*);
+  void updateCrc(SimulatedDevice*);
+  uint8_t next(void);
+};
+
+#endif
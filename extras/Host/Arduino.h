@@ -0,0 +1,25 @@
+// Host stand-in for the Arduino core, just enough to build
+// DallasTemperature.cpp on Linux for the tools in extras.
+// Time is virtual: each tool's DS2480B stand-in advances it for every bus
+// operation and delay() advances it by the requested amount.
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern unsigned long hostClock; // microseconds, defined by the tool
+
+static inline unsigned long micros(void) { return hostClock; }
+static inline unsigned long millis(void) { return hostClock / 1000; }
+static inline void delay(unsigned long ms) { hostClock += ms * 1000; }
+static inline void delayMicroseconds(unsigned int us) { hostClock += us; }
+
+// macros, like the real core, so arguments are evaluated the same number of times
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+#endif
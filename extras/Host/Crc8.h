@@ -0,0 +1,28 @@
+// Dallas/Maxim CRC-8 for the host DS2480B stand-ins, which have to provide
+// the driver's static crc8().
+
+#ifndef Crc8_h
+#define Crc8_h
+
+#include <stdint.h>
+
+// x^8 + x^5 + x^4 + 1
+static inline uint8_t hostCrc8(const uint8_t* addr, uint8_t len)
+{
+  uint8_t crc = 0;
+
+  while (len--)
+  {
+    uint8_t inbyte = *addr++;
+    for (uint8_t i = 8; i; i--)
+    {
+      uint8_t mix = (crc ^ inbyte) & 0x01;
+      crc >>= 1;
+      if (mix) crc ^= 0x8C;
+      inbyte >>= 1;
+    }
+  }
+  return crc;
+}
+
+#endif
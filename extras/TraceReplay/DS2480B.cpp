@@ -0,0 +1,240 @@
+// Trace driven DS2480B stand-in, see DS2480B.h
+
+#include <algorithm>
+#include "DS2480B.h"
+#include "DallasTemperature.h"
+#include "Arduino.h"
+#include "Crc8.h"
+
+DS2480B::DS2480B()
+{
+  misses = 0;
+  begins = 0;
+  enumeration = 0;
+  found = 0;
+  restart(&current);
+  replies = NULL;
+  reply = 0;
+  for (int i = 0; i < 256; i++) cost[i] = 0;
+}
+
+bool DS2480B::load(const uint8_t* trace, size_t length)
+{
+  if (length % TRACE_RECORD_SIZE) return false;
+
+  std::vector<unsigned long> samples[256];
+  Transaction recorded;
+  restart(&recorded);
+  bool searching = false;
+  unsigned long high = 0;
+  Key key;
+  Rom rom;
+
+  for (size_t i = 0; i < length; i += TRACE_RECORD_SIZE)
+  {
+    uint8_t operation = trace[i];
+    uint8_t data = trace[i + 1];
+    unsigned long elapsed = trace[i + 2] | (trace[i + 3] << 8);
+
+    if (operation == TRACE_DELAY)
+    {
+      high = elapsed << 16;
+      continue;
+    }
+    samples[operation].push_back(high | elapsed);
+    high = 0;
+
+    switch (operation)
+    {
+      case TRACE_BEGIN:
+        enumerations.push_back(std::vector<Rom>());
+        break;
+
+      case TRACE_SEARCH:
+        if (enumerations.empty()) enumerations.push_back(std::vector<Rom>());
+        rom.clear();
+        searching = data != 0;
+        break;
+
+      case TRACE_ROM:
+        if (searching)
+        {
+          rom.push_back(data);
+          if (rom.size() < 8) break;
+          enumerations.back().push_back(rom);
+          searching = false;
+        }
+        else if (recorded.phase == MATCHING)
+        {
+          written(&recorded, data);
+        }
+        break;
+
+      case TRACE_RESET:
+        restart(&recorded);
+        break;
+
+      case TRACE_SELECT:
+        recorded.device.clear();
+        recorded.phase = MATCHING;
+        break;
+
+      case TRACE_SKIP:
+        recorded.device.clear();
+        recorded.phase = FUNCTION;
+        break;
+
+      case TRACE_WRITE:
+      case TRACE_WRITE_POWER:
+        if (!written(&recorded, data)) break;
+        key = Key(recorded.device, data);
+        transactions[key].push_back(Replies());
+        break;
+
+      case TRACE_READ:
+      case TRACE_READ_BIT:
+        if (recorded.phase == DATA) transactions[key].back().push_back(data);
+        break;
+
+      default:
+        return false;
+    }
+  }
+
+  // medians, so the long gaps left by conversion delays do not skew them
+  for (int i = 0; i < 256; i++)
+  {
+    if (samples[i].empty()) continue;
+    std::sort(samples[i].begin(), samples[i].end());
+    cost[i] = samples[i][samples[i].size() / 2];
+  }
+  return true;
+}
+
+// a reset ends the transaction, the next byte is a ROM command
+void DS2480B::restart(Transaction* transaction)
+{
+  transaction->phase = ROM_COMMAND;
+  transaction->device.clear();
+}
+
+// advances a transaction by a written byte, true if it was the function command
+bool DS2480B::written(Transaction* transaction, uint8_t v)
+{
+  switch (transaction->phase)
+  {
+    case ROM_COMMAND:
+      transaction->device.clear();
+      if (v == MATCHROM) transaction->phase = MATCHING;
+      else if (v == SKIPROM) transaction->phase = FUNCTION;
+      // other ROM commands address nothing we replay
+      else transaction->phase = DATA;
+      return false;
+
+    case MATCHING:
+      transaction->device.push_back(v);
+      if (transaction->device.size() == 8) transaction->phase = FUNCTION;
+      return false;
+
+    case FUNCTION:
+      transaction->phase = DATA;
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+void DS2480B::spend(uint8_t operation)
+{
+  hostClock += cost[operation];
+}
+
+void DS2480B::begin(void)
+{
+  spend(TRACE_BEGIN);
+  enumeration = begins++;
+  if (!enumerations.empty() && enumeration >= enumerations.size()) enumeration = enumerations.size() - 1;
+}
+
+void DS2480B::reset_search(void)
+{
+  found = 0;
+}
+
+uint8_t DS2480B::search(uint8_t* newAddr)
+{
+  spend(TRACE_SEARCH);
+  if (enumeration >= enumerations.size()) return 0;
+  const std::vector<Rom>& roms = enumerations[enumeration];
+  if (found >= roms.size()) return 0;
+  std::copy(roms[found].begin(), roms[found].end(), newAddr);
+  found++;
+  return 1;
+}
+
+uint8_t DS2480B::reset(void)
+{
+  spend(TRACE_RESET);
+  restart(&current);
+  replies = NULL;
+  return 1;
+}
+
+void DS2480B::select(const uint8_t* rom)
+{
+  spend(TRACE_SELECT);
+  current.device.assign(rom, rom + 8);
+  current.phase = FUNCTION;
+}
+
+void DS2480B::skip(void)
+{
+  spend(TRACE_SKIP);
+  current.device.clear();
+  current.phase = FUNCTION;
+}
+
+void DS2480B::write(uint8_t v, uint8_t power)
+{
+  spend(power ? TRACE_WRITE_POWER : TRACE_WRITE);
+  if (written(&current, v)) command(v);
+}
+
+// picks the recorded replies for the transaction this command starts
+void DS2480B::command(uint8_t v)
+{
+  Key key(current.device, v);
+  std::map<Key, std::vector<Replies> >::const_iterator it = transactions.find(key);
+  replies = NULL;
+  reply = 0;
+  if (it == transactions.end()) return;
+
+  size_t index = played[key]++;
+  if (index >= it->second.size()) index = it->second.size() - 1;
+  replies = &it->second[index];
+}
+
+uint8_t DS2480B::next(void)
+{
+  if (replies != NULL && reply < replies->size()) return (*replies)[reply++];
+  misses++;
+  return 0xFF;
+}
+
+uint8_t DS2480B::read(void)
+{
+  spend(TRACE_READ);
+  return next();
+}
+
+uint8_t DS2480B::read_bit(void)
+{
+  spend(TRACE_READ_BIT);
+  return next();
+}
+
+uint8_t DS2480B::crc8(const uint8_t* addr, uint8_t len)
+{
+  return hostCrc8(addr, len);
+}
@@ -0,0 +1,86 @@
+// Host stand-in for the DS2480B driver that answers DallasTemperature from a
+// trace recorded with REQUIRESTRACE (see DallasTemperature.h for the format).
+//
+// Replies are looked up by transaction rather than by position, so a library
+// version that adds or drops whole transactions still gets sensible data:
+// a transaction is reset, select/skip, command byte, then any reads, and each
+// (device ROM, command) pair replays its recorded replies in order, repeating
+// the last one once they run out. Match and skip ROM are recognized whether
+// they went through select()/skip() or were written as plain bytes, as tick()
+// does. Searches replay the enumeration recorded after the matching begin().
+//
+// Every operation advances the virtual clock by the median time that
+// operation took in the trace.
+
+#ifndef DS2480B_h
+#define DS2480B_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+class DS2480B
+{
+  public:
+
+  DS2480B();
+
+  // builds the reply tables and timing model, false if the trace is malformed
+  bool load(const uint8_t*, size_t);
+
+  // reads the trace had no reply for
+  unsigned long misses;
+
+  void begin(void);
+  void reset_search(void);
+  uint8_t search(uint8_t*);
+  uint8_t reset(void);
+  void select(const uint8_t*);
+  void skip(void);
+  void write(uint8_t, uint8_t power = 0);
+  uint8_t read(void);
+  uint8_t read_bit(void);
+
+  static uint8_t crc8(const uint8_t*, uint8_t);
+
+  private:
+
+  typedef std::vector<uint8_t> Rom;
+  typedef std::vector<uint8_t> Replies;
+
+  // device ROM and command, the ROM is empty for skip ROM
+  typedef std::pair<Rom, uint8_t> Key;
+
+  // where a transaction is between two resets
+  enum Phase { ROM_COMMAND, MATCHING, FUNCTION, DATA };
+
+  typedef struct
+  {
+    Phase phase;
+    Rom device;
+  } Transaction;
+
+  std::vector<std::vector<Rom> > enumerations;
+  std::map<Key, std::vector<Replies> > transactions;
+  std::map<Key, size_t> played;
+  unsigned long cost[256];
+
+  // replay position
+  size_t begins;
+  size_t enumeration;
+  size_t found;
+  Transaction current;
+  const Replies* replies;
+  size_t reply;
+
+  static void restart(Transaction*);
+  static bool written(Transaction*, uint8_t);
+
+  void spend(uint8_t);
+  void command(uint8_t);
+  uint8_t next(void);
+};
+
+#endif
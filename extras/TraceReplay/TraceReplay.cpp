@@ -0,0 +1,179 @@
+// Replays a bus trace recorded with REQUIRESTRACE against this version of
+// DallasTemperature and reports how its bus traffic differs from the
+// version that recorded it.
+//
+// Build on Linux from the library root:
+//   g++ -DARDUINO=100 -DREQUIRESTRACE=true -Iextras/Host -Iextras/TraceReplay
+//       -I. DallasTemperature.cpp extras/TraceReplay/DS2480B.cpp
+//       extras/TraceReplay/TraceReplay.cpp -o TraceReplay
+//
+// Usage: TraceReplay [-p microamps] [-r index:bits]... [-t budget_us]
+//                    <trace.bin> [blocking|tick] [cycles]
+//
+// The scenario has to match what the sketch did while recording: begin()
+// then, for each cycle, either requestTemperatures() and readSensor() for
+// every device (blocking, the default) or tick(budget) until the cycle
+// completes (tick). examples/TraceCapture records a blocking trace.
+// Options set up the rest of the sketch after begin():
+//   -p  setParasiteBudget(microamps)
+//   -r  a resolution change for the device at index: setResolution() in
+//       blocking mode, scheduleResolution() in tick mode; may be repeated
+//   -t  the tick() budget, 1000 by default
+// Anything else the sketch did on the bus, such as resolution changes
+// between cycles, writeScratchPad() calls or traffic to other 1-Wire
+// devices, is not replayed and shows up as deltas and misses.
+//
+// Output is one tab separated line per metric: name, recorded, replayed,
+// and replayed - recorded. Time is the sum of the record timestamps,
+// including the upper bits TRACE_DELAY records carry for long gaps.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "DS2480B.h"
+#include "DallasTemperature.h"
+#include "Arduino.h"
+
+unsigned long hostClock = 0;
+
+static const char* operationNames[] =
+{
+  "unknown", "begin", "search", "rom", "reset", "select",
+  "skip", "write", "write_power", "read", "read_bit", "delay"
+};
+#define OPERATIONS (sizeof(operationNames) / sizeof(operationNames[0]))
+
+typedef struct
+{
+  unsigned long records;
+  unsigned long time;
+  unsigned long operations[OPERATIONS];
+} Summary;
+
+static void summarize(const uint8_t* trace, size_t length, Summary* summary)
+{
+  memset(summary, 0, sizeof(Summary));
+  for (size_t i = 0; i + TRACE_RECORD_SIZE <= length; i += TRACE_RECORD_SIZE)
+  {
+    uint8_t operation = trace[i];
+    unsigned long elapsed = trace[i + 2] | (trace[i + 3] << 8);
+    summary->records++;
+    summary->time += operation == TRACE_DELAY ? elapsed << 16 : elapsed;
+    summary->operations[operation < OPERATIONS ? operation : 0]++;
+  }
+}
+
+static void report(const char* name, unsigned long recorded, unsigned long replayed)
+{
+  printf("%s\t%lu\t%lu\t%+ld\n", name, recorded, replayed, (long)replayed - (long)recorded);
+}
+
+typedef struct
+{
+  uint8_t index;
+  uint8_t bits;
+} ResolutionChange;
+
+static int usage(const char* name)
+{
+  fprintf(stderr, "usage: %s [-p microamps] [-r index:bits]... [-t budget_us] <trace.bin> [blocking|tick] [cycles]\n",
+    name);
+  return 2;
+}
+
+int main(int argc, char** argv)
+{
+  long parasiteBudget = -1;
+  long tickBudget = 1000;
+  std::vector<ResolutionChange> resolutions;
+  int option;
+  while ((option = getopt(argc, argv, "p:r:t:")) != -1)
+  {
+    switch (option)
+    {
+      case 'p':
+        parasiteBudget = atol(optarg);
+        if (parasiteBudget < 0 || parasiteBudget > 0xFFFF) return usage(argv[0]);
+        break;
+
+      case 'r':
+      {
+        unsigned index, bits;
+        if (sscanf(optarg, "%u:%u", &index, &bits) != 2 || index >= MAX_DEVICES || bits < 9 || bits > 12)
+          return usage(argv[0]);
+        ResolutionChange change = { (uint8_t)index, (uint8_t)bits };
+        resolutions.push_back(change);
+        break;
+      }
+
+      case 't':
+        tickBudget = atol(optarg);
+        if (tickBudget <= 0 || tickBudget > 0xFFFF) return usage(argv[0]);
+        break;
+
+      default:
+        return usage(argv[0]);
+    }
+  }
+  if (optind >= argc) return usage(argv[0]);
+  const char* path = argv[optind];
+  bool ticking = optind + 1 < argc && strcmp(argv[optind + 1], "tick") == 0;
+  int cycles = optind + 2 < argc ? atoi(argv[optind + 2]) : 1;
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    perror(path);
+    return 2;
+  }
+  std::vector<uint8_t> recorded;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) recorded.insert(recorded.end(), chunk, chunk + n);
+  fclose(file);
+
+  DS2480B wire;
+  if (!wire.load(recorded.data(), recorded.size()))
+  {
+    fprintf(stderr, "%s: not a DallasTemperature trace\n", path);
+    return 2;
+  }
+
+  static uint8_t replayed[65532];
+  DallasTemperature sensors(&wire);
+  sensors.setTraceBuffer(replayed, sizeof(replayed));
+
+  sensors.begin();
+  if (parasiteBudget >= 0) sensors.setParasiteBudget(parasiteBudget);
+  for (size_t i = 0; i < resolutions.size(); i++)
+  {
+    if (ticking) sensors.scheduleResolution(resolutions[i].index, resolutions[i].bits);
+    else sensors.setResolution(resolutions[i].index, resolutions[i].bits);
+  }
+
+  for (int cycle = 0; cycle < cycles; cycle++)
+  {
+    if (ticking)
+    {
+      while (!sensors.tick(tickBudget).cycleComplete) hostClock += tickBudget;
+    }
+    else
+    {
+      sensors.requestTemperatures();
+      for (uint8_t i = 0; i < sensors.getDeviceCount(); i++) sensors.readSensor(i);
+    }
+  }
+
+  Summary before, after;
+  summarize(recorded.data(), recorded.size(), &before);
+  summarize(replayed, sensors.getTraceLength(), &after);
+
+  printf("# metric\trecorded\treplayed\tdelta\n");
+  report("records", before.records, after.records);
+  report("time_us", before.time, after.time);
+  for (size_t i = 1; i < OPERATIONS; i++) report(operationNames[i], before.operations[i], after.operations[i]);
+  report("misses", 0, wire.misses);
+  report("dropped", 0, sensors.getTraceDropped());
+  return 0;
+}